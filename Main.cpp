@@ -6,6 +6,7 @@
 #include <sstream> // stringstream
 #include <fstream>
 
+#include "SessionStore.h"
 #include "Simulation.h"
 
 #define COL_COUNT				8
@@ -36,6 +37,8 @@ bool setTotalScenariosToRun(std::string input);
 bool setAlgorithm(std::string input);
 bool viewSimulationParameters();
 bool runSimulation(); // Runs the simulation given the parameters for scenarioCount times, averages the results and stores in memory (to be printed later)
+bool setTraceCapture(std::string input); // The next 'rr' writes its scenarios to this trace file
+bool replayTrace(std::string input); // Runs the current algorithm on the scenarios in a trace file and stores the results like 'rr' does
 bool printSession();
 bool newSession();
 bool setSaveFileName(std::string input);
@@ -51,6 +54,7 @@ bool stringToInt(std::string string, int* storeValue);
 
 std::string doubleOutput(double d);
 void outputFormattedColCentered(std::ofstream* file, std::string value);
+bool saveResults(); // Appends the simulation's results to the session
 
 /////////////////////////////////
 // Variables
@@ -58,7 +62,8 @@ void outputFormattedColCentered(std::ofstream* file, std::string value);
 
 std::string directory;
 std::string filename("ATW_Session_Results.txt");
-std::vector<Simulation> session;
+Simulation simulation; // The parameters for the next run, results are copied out of it into the session
+SessionStore session;
 
 /////////////////////////////////
 // Implementation
@@ -96,7 +101,6 @@ int main(int argc, char** argv)
 		}
 	}
 	
-	session.push_back(Simulation()); // We always start with one simulation ready
 	userLoop();
 	
 	return 0;
@@ -147,6 +151,12 @@ bool consumeCommand(std::string input)
 		else if(input.size() == 2 && input[0] == 'r' && input[1] == 'r')
 			return runSimulation();
 		
+		else if(input.size() >= 4 && input[0] == 't' && input[1] == 'c')
+			return setTraceCapture(input);
+		
+		else if(input.size() >= 4 && input[0] == 't' && input[1] == 'r')
+			return replayTrace(input);
+		
 		else if(input.size() == 2 && input[0] == 'p' && input[1] == 's')
 			return printSession();
 		
@@ -186,9 +196,11 @@ bool help()
 	std::cout << "Enter 'rs <Number of ready stations>' to set the number of ready stations (default 1)." << std::endl;
 	std::cout << "Enter 'sl <Level to start at>' to set the starting probe level (default 0)." << std::endl;
 	std::cout << "Enter 'sc <Scenario count>' to set the number of scenario runs (default 100)." << std::endl;
-	std::cout << "Enter 'pa <a or b>' to set the probing algorithm. 'a': advanced, 'b': basic (default b). Note: advanced optimizes start level." << std::endl;
+	std::cout << "Enter 'pa <a, e or b>' to set the probing algorithm. 'a': advanced, 'e': advanced with K estimated, 'b': basic (default b). Note: advanced optimizes start level." << std::endl;
 	std::cout << "Enter 'vs' to start a view the simulation parameters" << std::endl;
 	std::cout << "Enter 'rr' to run the a simulation." << std::endl;
+	std::cout << "Enter 'tc <Filename>' to capture the next simulation's scenarios to a binary trace file in the save directory." << std::endl;
+	std::cout << "Enter 'tr <Filename>' to replay a trace file from the save directory with the current algorithm and start level, the results are saved to the session like 'rr'." << std::endl;
 	std::cout << "Enter 'ps' to print the results of the current session to file." << std::endl;
 	std::cout << "Enter 'ns' to start a new session, will clear all the data from the previous session." << std::endl;
 	std::cout << "Enter 'fn <Filename.txt>' to set the filename to save to (defaults to ATW_Session_Results.txt)." << std::endl;
@@ -209,7 +221,7 @@ bool setTotalStations(std::string input)
 		else if(stationsN > 1048576) // This is 2^20
 			std::cout << "Please enter a value less than or equal to 1048576 (2^20)" << std::endl;
 		else
-			session.back().stationsN = stationsN;
+			simulation.stationsN = stationsN;
 	}
 	else
 	{
@@ -227,7 +239,7 @@ bool setNumReadyStations(std::string input)
 		if(readyStationsK <= 0)
 			std::cout << "Please enter a value greater than 0." << std::endl;
 		else
-			session.back().readyStationsK = readyStationsK;
+			simulation.readyStationsK = readyStationsK;
 	}
 	else
 	{
@@ -245,7 +257,7 @@ bool setStartingLevel(std::string input)
 		if(probeLevelI < 0)
 			std::cout << "Please enter a value greater than or equal to 0." << std::endl;
 		else
-			session.back().probeLevelI = probeLevelI;
+			simulation.probeLevelI = probeLevelI;
 	}
 	else
 	{
@@ -263,7 +275,7 @@ bool setTotalScenariosToRun(std::string input)
 		if(scenariosX <= 0)
 			std::cout << "Please enter a value greater than 0." << std::endl;
 		else
-			session.back().scenariosX = scenariosX;
+			simulation.scenariosX = scenariosX;
 	}
 	else
 	{
@@ -276,11 +288,22 @@ bool setTotalScenariosToRun(std::string input)
 bool setAlgorithm(std::string input)
 {
 	if(input.substr(3, std::string::npos)[0] == 'b')
-		session.back().useBasicAlg = true;
+	{
+		simulation.useBasicAlg = true;
+		simulation.estimateK = false;
+	}
 	else if(input.substr(3, std::string::npos)[0] == 'a')
-		session.back().useBasicAlg = false;
+	{
+		simulation.useBasicAlg = false;
+		simulation.estimateK = false;
+	}
+	else if(input.substr(3, std::string::npos)[0] == 'e')
+	{
+		simulation.useBasicAlg = false;
+		simulation.estimateK = true;
+	}
 	else
-		std::cout << "Please enter either an 'a' for advanced algorithm, or 'b' for basic." << std::endl;
+		std::cout << "Please enter either an 'a' for advanced algorithm, 'e' for advanced with K estimated, or 'b' for basic." << std::endl;
 	
 	return true;
 }
@@ -288,16 +311,21 @@ bool setAlgorithm(std::string input)
 bool viewSimulationParameters()
 {
 	std::cout << "Simulation will run with: " << std::endl;
-	std::cout << session.back().stationsN << " Station(s)." << std::endl;
-	std::cout << session.back().readyStationsK << " Ready station(s)." << std::endl;
-	std::cout << session.back().probeLevelI << " As the starting probe level." << std::endl;
-	std::cout << session.back().scenariosX << " Scenario(s)." << std::endl;
+	std::cout << simulation.stationsN << " Station(s)." << std::endl;
+	std::cout << simulation.readyStationsK << " Ready station(s)." << std::endl;
+	std::cout << simulation.probeLevelI << " As the starting probe level." << std::endl;
+	std::cout << simulation.scenariosX << " Scenario(s)." << std::endl;
 	
-	if(session.back().useBasicAlg)
+	if(simulation.useBasicAlg)
 		std::cout << "The basic algorithm" << std::endl;
+	else if(simulation.estimateK)
+		std::cout << "The advanced algorithm, estimating K (the advanced algorithm given K is run alongside for comparison)" << std::endl;
 	else
 		std::cout << "The advanced algorithm" << std::endl;
 	
+	if(simulation.traceFile.empty() == false)
+		std::cout << "Capturing scenarios to " << simulation.traceFile << std::endl;
+	
 	return true;
 }
 
@@ -305,13 +333,40 @@ bool runSimulation()
 {
 	viewSimulationParameters();
 	std::cout << std::endl;
-	std::cout << session.back().run();
+	std::cout << simulation.run();
+	simulation.traceFile.clear(); // Only the one run is captured
+	
+	return saveResults();
+}
+
+bool setTraceCapture(std::string input)
+{
+	simulation.traceFile = directory + "/" + input.substr(3, std::string::npos);
+	std::cout << "The next simulation run will be captured to " << simulation.traceFile << std::endl;
+	return true;
+}
+
+bool replayTrace(std::string input)
+{
+	// The replay takes its workload from the trace, so the parameters set for the next 'rr' are put back once its results are saved.
+	int stationsN = simulation.stationsN;
+	int readyStationsK = simulation.readyStationsK;
+	int probeLevelI = simulation.probeLevelI;
+	int scenariosX = simulation.scenariosX;
 	
-	// We are starting a new simulation to collect data on now in this session.
-	session.push_back(Simulation(session.back().stationsN, session.back().readyStationsK, session.back().probeLevelI, session.back().scenariosX, session.back().useBasicAlg));
+	std::string message;
+	bool replayed = simulation.replay(directory + "/" + input.substr(3, std::string::npos), &message);
+	std::cout << message;
 	
-	std::cout << std::endl;
-	std::cout << "Done Saving data to session, you are on a new simulation with default values now." << std::endl;
+	if(replayed == false) // Nothing was replayed, so there is nothing to keep
+		return true;
+	
+	saveResults();
+	
+	simulation.stationsN = stationsN;
+	simulation.readyStationsK = readyStationsK;
+	simulation.probeLevelI = probeLevelI;
+	simulation.scenariosX = scenariosX;
 	return true;
 }
 
@@ -334,20 +389,29 @@ bool printSession()
 			file << '-';
 	file << "\r\n";
 	
-	for(unsigned int i = 0; i < session.size() - 1; i++) // -1 because the current simulation (at the end of the session's simulation list) has not yet been run
+	for(size_t i = 0; i < session.size(); i++)
 	{
-		if(session[i].useBasicAlg)
+		const ResultRecord* record = session.get(i);
+		if(record == NULL) // Still being written by whoever appended it
+			continue;
+		
+		if(record->algorithm == RESULT_BASIC)
 			outputFormattedColCentered(&file, "Basic");
-		else
+		else if(record->algorithm == RESULT_ADVANCED)
 			outputFormattedColCentered(&file, "Advanced");
+		else
+			outputFormattedColCentered(&file, "Adv-Est");
 		
-		outputFormattedColCentered(&file, std::to_string(session[i].stationsN));
-		outputFormattedColCentered(&file, std::to_string(session[i].readyStationsK));
-		outputFormattedColCentered(&file, std::to_string(session[i].probeLevelActuallyUsed));
-		outputFormattedColCentered(&file, std::to_string(session[i].scenariosX));
-		outputFormattedColCentered(&file, doubleOutput(session[i].getSuccessProbesPercent()));
-		outputFormattedColCentered(&file, doubleOutput(session[i].getCollisionProbesPercent()));
-		outputFormattedColCentered(&file, doubleOutput(session[i].getIdleProbesPercent()));
+		outputFormattedColCentered(&file, std::to_string(record->stationsN));
+		outputFormattedColCentered(&file, std::to_string(record->readyStationsK));
+		if(record->algorithm == RESULT_ESTIMATED)
+			outputFormattedColCentered(&file, doubleOutput(record->startLevel)); // Estimated per scenario, so this is the average
+		else
+			outputFormattedColCentered(&file, std::to_string((int)record->startLevel));
+		outputFormattedColCentered(&file, std::to_string(record->scenariosX));
+		outputFormattedColCentered(&file, doubleOutput(record->successPercent));
+		outputFormattedColCentered(&file, doubleOutput(record->collisionPercent));
+		outputFormattedColCentered(&file, doubleOutput(record->idlePercent));
 		file << "\r\n";
 	}
 	file.close();
@@ -359,7 +423,7 @@ bool printSession()
 bool newSession()
 {
 	session.clear();
-	session.push_back(Simulation());
+	simulation = Simulation();
 	return true;
 }
 
@@ -409,6 +473,20 @@ std::string doubleOutput(double d)
 	return stream.str();
 }
 
+bool saveResults()
+{
+	ResultRecord records[2];
+	int count = simulation.getResultRecords(records);
+	
+	std::cout << std::endl;
+	if(session.append(records, count))
+		std::cout << "Done Saving data to session, the next simulation will run with the same parameters." << std::endl;
+	else
+		std::cout << "The session is full, these results were not saved. Print the session and start a new one." << std::endl;
+	
+	return true;
+}
+
 void outputFormattedColCentered(std::ofstream* file, std::string value)
 {
 	int spaces = (OUTPUT_COL_WIDTH - value.size()) / 2;
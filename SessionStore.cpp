@@ -0,0 +1,86 @@
+#include "SessionStore.h"
+
+#define SESSION_CAPACITY ((size_t)SESSION_CHUNK_RECORDS * SESSION_MAX_CHUNKS)
+
+SessionStore::SessionStore():
+reserved(0)
+{
+	for(int c = 0; c < SESSION_MAX_CHUNKS; c++)
+		chunks[c].store(NULL, std::memory_order_relaxed);
+}
+
+SessionStore::~SessionStore()
+{
+	clear();
+}
+
+SessionStore::Chunk::Chunk()
+{
+	for(int r = 0; r < SESSION_CHUNK_RECORDS; r++)
+		published[r].store(false, std::memory_order_relaxed);
+}
+
+bool SessionStore::append(const ResultRecord* records, int count)
+{
+	size_t first = reserved.fetch_add(count);
+	if(first + count > SESSION_CAPACITY)
+		return false; // Those slots are simply never used
+	
+	for(int r = 0; r < count; r++)
+	{
+		size_t index = first + r;
+		Chunk* chunk = chunkFor(index);
+		chunk->records[index % SESSION_CHUNK_RECORDS] = records[r];
+		chunk->published[index % SESSION_CHUNK_RECORDS].store(true, std::memory_order_release);
+	}
+	
+	return true;
+}
+
+size_t SessionStore::size()
+{
+	size_t count = reserved.load(std::memory_order_acquire);
+	if(count > SESSION_CAPACITY)
+		count = SESSION_CAPACITY;
+	
+	return count;
+}
+
+const ResultRecord* SessionStore::get(size_t index)
+{
+	if(index >= SESSION_CAPACITY)
+		return NULL;
+	
+	Chunk* chunk = chunks[index / SESSION_CHUNK_RECORDS].load(std::memory_order_acquire);
+	if(chunk == NULL || chunk->published[index % SESSION_CHUNK_RECORDS].load(std::memory_order_acquire) == false)
+		return NULL;
+	
+	return &chunk->records[index % SESSION_CHUNK_RECORDS];
+}
+
+void SessionStore::clear()
+{
+	for(int c = 0; c < SESSION_MAX_CHUNKS; c++)
+	{
+		delete chunks[c].load(std::memory_order_relaxed);
+		chunks[c].store(NULL, std::memory_order_relaxed);
+	}
+	
+	reserved.store(0);
+}
+
+SessionStore::Chunk* SessionStore::chunkFor(size_t index)
+{
+	std::atomic<Chunk*>* slot = &chunks[index / SESSION_CHUNK_RECORDS];
+	Chunk* chunk = slot->load(std::memory_order_acquire);
+	if(chunk != NULL)
+		return chunk;
+	
+	// Several threads can get here for the same chunk, only one of them gets to install theirs.
+	Chunk* fresh = new Chunk();
+	if(slot->compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+		return fresh;
+	
+	delete fresh;
+	return chunk; // Filled in with the winner by the failed compare and swap
+}
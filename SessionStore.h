@@ -0,0 +1,58 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <atomic>
+#include <stddef.h>
+
+#define SESSION_CHUNK_RECORDS	4096
+#define SESSION_MAX_CHUNKS		1024 // 4M records of 48 bytes each at most, the chunk table itself is only 8KB
+
+#define RESULT_BASIC		0
+#define RESULT_ADVANCED		1
+#define RESULT_ESTIMATED	2 // Advanced with K estimated, always stored right after the advanced result it was run alongside
+
+// One row of the session table. Fixed size so a session costs the same per result no matter how it was run.
+struct ResultRecord
+{
+	int stationsN;
+	int readyStationsK;
+	int scenariosX;
+	unsigned char algorithm;
+	double startLevel; // Average over the scenarios when the level is estimated
+	double successPercent; // Kept as doubles so the printed table matches what the Simulation computed
+	double collisionPercent;
+	double idlePercent;
+};
+
+// Append only storage for the session's results, split into fixed size chunks that are never moved, so a pointer to a record stays valid until clear().
+// append() and get() are lock-free and safe to call from any number of threads at once; clear() is not. A slot is reserved with one atomic add,
+// a missing chunk is installed with a compare and swap, and each record is flagged once it is fully written so readers never see half of one.
+class SessionStore
+{
+	public:
+		SessionStore();
+		~SessionStore();
+		SessionStore(const SessionStore&) = delete;
+		SessionStore& operator=(const SessionStore&) = delete;
+		
+		bool append(const ResultRecord* records, int count); // The records get consecutive slots. false if the store is full.
+		size_t size(); // Slots handed out so far, some may still be being written
+		const ResultRecord* get(size_t index); // NULL if the record at index is not written yet
+		void clear(); // Not safe while other threads are appending
+	
+	private:
+		struct Chunk
+		{
+			ResultRecord records[SESSION_CHUNK_RECORDS];
+			std::atomic<bool> published[SESSION_CHUNK_RECORDS];
+			
+			Chunk();
+		};
+		
+		std::atomic<Chunk*> chunks[SESSION_MAX_CHUNKS];
+		std::atomic<size_t> reserved;
+		
+		Chunk* chunkFor(size_t index); // Allocates the chunk if no thread has yet
+};
+
+#endif
@@ -1,47 +1,46 @@
 #include <algorithm>    // std::random_shuffle
+#include <chrono>
 #include <iostream>
 #include <math.h>
+#include <stdlib.h> // rand
 
+#include "SessionStore.h"
 #include "Simulation.h"
+#include "Trace.h"
+
+#define ESTIMATION_SAMPLES 2 // Nodes sampled per level while estimating K
 
 Simulation::Simulation()
 {
 	
 }
 
-Simulation::Simulation(int n, int k, int i, int x, bool basic):
+Simulation::Simulation(int n, int k, int i, int x, bool basic, bool estimate):
 stationsN(n),
 readyStationsK(k),
 probeLevelI(i),
 scenariosX(x),
-useBasicAlg(basic)
+useBasicAlg(basic),
+estimateK(estimate)
 {
 	
 }
 
 std::string Simulation::run()
 {
-	int levelCount = 1;
-	int levelWidth = 1;
-	
-	// This loop determines the total number of levels for the tree. I could do this with the square root method, but thats more accuracy than needed for this.
-	while(levelWidth < stationsN)
-	{
-		levelCount++;
-		levelWidth <<= 1; // *= 2, but better
-	}
-	
 	std::string returnMessage = "Finished simulation.\r\n";
-	if(readyStationsK > stationsN)
-	{
-		readyStationsK = stationsN;
-		returnMessage += " Changed readyStationsK to equal stationsN as it was greater.\r\n";
-	}
+	int levelCount = prepareLevels(&returnMessage);
+	resetResults();
 	
-	if(probeLevelI > levelCount - 1)
+	TraceWriter trace;
+	std::vector<unsigned char> scenarioOutcomes;
+	std::vector<int> activeIds;
+	if(traceFile.empty() == false)
 	{
-		probeLevelI = levelCount - 1;
-		returnMessage += " Changed probeLevelI to be the last level as it was set to past this level.\r\n"; 
+		if(trace.open(traceFile, stationsN, probeLevelI, traceAlgorithm()))
+			probeLog = &scenarioOutcomes;
+		else
+			returnMessage += " Could not open the trace file, scenarios were not captured.\r\n";
 	}
 	
 	// Each node is a simple true or false, true for 'will transmit', false for 'will not'. 
@@ -65,42 +64,316 @@ std::string Simulation::run()
 			stations[k].active = true; // Note that readyStationsK is always less than or equal to stationsN
 		}
 		
-		probeLevelActuallyUsed = probeLevelI;
-		if(useBasicAlg == false)
-			probeLevelActuallyUsed = (int)round(log2((double)readyStationsK));
-		
-		// Start probing
-		int nodesToProbe = 1 << probeLevelActuallyUsed;
-		if(nodesToProbe > stationsN) 
-			nodesToProbe = stationsN;
-		int shuffle = levelCount - 1 - probeLevelActuallyUsed;
+		// Only the estimation phase needs a seed. Not drawing one otherwise keeps the shuffles, and so the results, the same as before traces existed.
+		unsigned int seed = 0;
+		if(useBasicAlg == false && estimateK == true)
+			seed = rand();
+		scenarioOutcomes.clear();
+		runScenario(&stations, levelCount, seed);
 		
-		if(useBasicAlg)
+		if(probeLog != NULL)
 		{
-			basicProbeWalkthrough(&stations, nodesToProbe, shuffle, 0);
+			activeIds.clear();
+			for(int k = 0; k < readyStationsK; k++)
+				activeIds.push_back(stations[k].number);
+			
+			trace.writeScenario(seed, &activeIds, &scenarioOutcomes);
 		}
-		else
+		
+		if((x + 1) % 25 == 0)
+			std::cout << "Scenarios: " << (x - 24) << " - " << (x) << " complete." << std::endl;
+	}
+	
+	if(probeLog != NULL)
+	{
+		trace.close();
+		probeLog = NULL;
+		returnMessage += " Scenarios captured to " + traceFile + "\r\n";
+	}
+	
+	return returnMessage;
+}
+
+bool Simulation::replay(std::string path, std::string* returnMessage)
+{
+	TraceReader trace;
+	if(trace.open(path) == false)
+	{
+		*returnMessage = "Could not read " + path + ", it is missing or not a trace file.\r\n";
+		return false;
+	}
+	
+	if(trace.scenarioCount <= 0)
+	{
+		*returnMessage = "The trace has no scenarios in it.\r\n";
+		return false;
+	}
+	
+	// The first scenario is read before anything is changed, so a trace that is cut short leaves this simulation as it was.
+	TraceScenario scenario;
+	if(trace.nextScenario(&scenario) == false)
+	{
+		*returnMessage = "The trace is cut short, not even one scenario could be read.\r\n";
+		return false;
+	}
+	
+	// The workload comes from the trace, the algorithm and start level are this simulation's. The caller restores the workload parameters afterwards.
+	stationsN = trace.stationsN;
+	scenariosX = trace.scenarioCount;
+	readyStationsK = scenario.activeIds.size(); // Set before prepareLevels() so it does not clamp, and report clamping, the user's K
+	
+	*returnMessage = "Finished replay.\r\n";
+	int levelCount = prepareLevels(returnMessage);
+	resetResults();
+	
+	// Stations stay in number order here, the walks only care about which numbers are active.
+	std::vector<Station> stations(stationsN);
+	for(int n = 0; n < stationsN; n++)
+		stations[n].number = n;
+	
+	std::vector<unsigned char> scenarioOutcomes;
+	probeLog = &scenarioOutcomes;
+	
+	int replayed = 0;
+	int mismatches = 0;
+	std::string firstMismatch; // Where the first differing scenario went wrong
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	do
+	{
+		readyStationsK = scenario.activeIds.size();
+		for(unsigned int k = 0; k < scenario.activeIds.size(); k++)
+			stations[scenario.activeIds[k]].active = true;
+		
+		scenarioOutcomes.clear();
+		runScenario(&stations, levelCount, scenario.seed);
+		
+		if(scenarioOutcomes != scenario.outcomes)
 		{
-			readyStationsLeft = readyStationsK;
-			advancedProbeWalkthrough(&stations, nodesToProbe, shuffle, 0, false);
+			if(mismatches == 0)
+			{
+				unsigned int probe = 0;
+				while(probe < scenarioOutcomes.size() && probe < scenario.outcomes.size() && scenarioOutcomes[probe] == scenario.outcomes[probe])
+					probe++;
+				
+				firstMismatch = " The first is scenario " + std::to_string(replayed) + ", at probe " + std::to_string(probe) + ": ";
+				if(probe < scenarioOutcomes.size() && probe < scenario.outcomes.size())
+					firstMismatch += std::string("recorded ") + traceOutcomeName(scenario.outcomes[probe]) + ", replayed " + traceOutcomeName(scenarioOutcomes[probe]) + ".\r\n";
+				else
+					firstMismatch += "one walk ended where the other kept probing.\r\n";
+				
+				if(scenarioOutcomes.size() != scenario.outcomes.size())
+					firstMismatch += " That scenario recorded " + std::to_string(scenario.outcomes.size()) + " probe(s), the replay made " + std::to_string(scenarioOutcomes.size()) + ".\r\n";
+			}
+			mismatches++;
 		}
 		
-		// Add to the percentages
-		double totalProbes = successProbes + collisionProbes + idleProbes; // This will always be greater than 0, as there is always one node.
-		cumulativeSuccessPercentage += (double)(successProbes) / totalProbes;
-		cumulativeCollisionPercentage += (double)(collisionProbes) / totalProbes;
-		cumulativeIdlePercentage += (double)(idleProbes) / totalProbes;
+		for(unsigned int k = 0; k < scenario.activeIds.size(); k++)
+			stations[scenario.activeIds[k]].active = false;
 		
-		// Reset the counters
-		successProbes = 0;
-		collisionProbes = 0;
-		idleProbes = 0;
+		replayed++;
+	}
+	while(replayed < scenariosX && trace.nextScenario(&scenario));
+	
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	probeLog = NULL;
+	
+	if(replayed < scenariosX)
+	{
+		*returnMessage += " The trace ended early, only " + std::to_string(replayed) + " scenario(s) could be read.\r\n";
+		scenariosX = replayed; // Keeps the percentages averaged over what actually ran
+	}
+	
+	*returnMessage += " Replayed " + std::to_string(replayed) + " scenario(s) in " + std::to_string(elapsed.count()) + " ms.\r\n";
+	if(mismatches == 0)
+		*returnMessage += " Every probe outcome matched the trace.\r\n";
+	else
+		*returnMessage += " " + std::to_string(mismatches) + " scenario(s) differ from the trace.\r\n" + firstMismatch;
+	
+	if(traceAlgorithm() != trace.algorithm || (useBasicAlg && probeLevelI != trace.probeLevelI))
+		*returnMessage += " Note: the trace was captured with a different algorithm or start level, so differences are expected.\r\n";
+	
+	return true;
+}
+
+int Simulation::traceAlgorithm()
+{
+	if(useBasicAlg)
+		return TRACE_ALG_BASIC;
+	else if(estimateK)
+		return TRACE_ALG_ESTIMATED;
+	else
+		return TRACE_ALG_ADVANCED;
+}
+
+void Simulation::resetResults()
+{
+	cumulativeSuccessPercentage = 0;
+	cumulativeCollisionPercentage = 0;
+	cumulativeIdlePercentage = 0;
+	
+	cumulativeOracleSuccessPercentage = 0;
+	cumulativeOracleCollisionPercentage = 0;
+	cumulativeOracleIdlePercentage = 0;
+	cumulativeEstimatedLevel = 0;
+}
+
+int Simulation::prepareLevels(std::string* returnMessage)
+{
+	int levelCount = 1;
+	int levelWidth = 1;
+	
+	// This loop determines the total number of levels for the tree. I could do this with the square root method, but thats more accuracy than needed for this.
+	while(levelWidth < stationsN)
+	{
+		levelCount++;
+		levelWidth <<= 1; // *= 2, but better
+	}
+	
+	if(readyStationsK > stationsN)
+	{
+		readyStationsK = stationsN;
+		*returnMessage += " Changed readyStationsK to equal stationsN as it was greater.\r\n";
+	}
+	
+	if(probeLevelI > levelCount - 1)
+	{
+		probeLevelI = levelCount - 1;
+		*returnMessage += " Changed probeLevelI to be the last level as it was set to past this level.\r\n"; 
+	}
+	
+	return levelCount;
+}
+
+void Simulation::runScenario(std::vector<Station>* stations, int levelCount, unsigned int seed)
+{
+	estimationRandom.seed(seed); // Seeded per scenario so a replay samples the same nodes
+	sampledNodes.clear();
+	
+	probeLevelActuallyUsed = probeLevelI;
+	if(useBasicAlg == false)
+		probeLevelActuallyUsed = (int)round(log2((double)readyStationsK));
+	
+	if(useBasicAlg == false && estimateK == true)
+	{
+		oracleProbeLevel = (int)round(log2((double)readyStationsK));
 		
-		if((x + 1) % 25 == 0)
-			std::cout << "Scenarios: " << (x - 24) << " - " << (x) << " complete." << std::endl;
+		// Run the oracle version on this exact station set first so the two can be compared side by side. It is not part of what gets captured.
+		std::vector<unsigned char>* capturing = probeLog;
+		probeLog = NULL;
+		
+		int oracleNodesToProbe = 1 << oracleProbeLevel;
+		if(oracleNodesToProbe > stationsN)
+			oracleNodesToProbe = stationsN;
+		
+		readyStationsLeft = readyStationsK;
+		advancedProbeWalkthrough(stations, oracleNodesToProbe, levelCount - 1 - oracleProbeLevel, 0, false);
+		addScenarioPercentages(&cumulativeOracleSuccessPercentage, &cumulativeOracleCollisionPercentage, &cumulativeOracleIdlePercentage);
+		
+		probeLog = capturing;
+		probeLevelActuallyUsed = estimateStartLevel(stations, levelCount);
+		cumulativeEstimatedLevel += probeLevelActuallyUsed;
 	}
 	
-	return returnMessage;
+	// Start probing
+	int nodesToProbe = 1 << probeLevelActuallyUsed;
+	if(nodesToProbe > stationsN) 
+		nodesToProbe = stationsN;
+	int shuffle = levelCount - 1 - probeLevelActuallyUsed;
+	
+	if(useBasicAlg)
+	{
+		basicProbeWalkthrough(stations, nodesToProbe, shuffle, 0);
+	}
+	else
+	{
+		readyStationsLeft = readyStationsK;
+		if(estimateK == true)
+			readyStationsLeft = -1; // K is unknown, so the walk can not stop early once every ready station has been heard from.
+		
+		advancedProbeWalkthrough(stations, nodesToProbe, shuffle, 0, false);
+	}
+	
+	addScenarioPercentages(&cumulativeSuccessPercentage, &cumulativeCollisionPercentage, &cumulativeIdlePercentage);
+}
+
+void Simulation::logProbe(unsigned char outcome)
+{
+	if(probeLog != NULL)
+		probeLog->push_back(outcome);
+}
+
+void Simulation::addScenarioPercentages(double* success, double* collision, double* idle)
+{
+	// Add to the percentages
+	double totalProbes = successProbes + collisionProbes + idleProbes; // This will always be greater than 0, as there is always one node.
+	*success += (double)(successProbes) / totalProbes;
+	*collision += (double)(collisionProbes) / totalProbes;
+	*idle += (double)(idleProbes) / totalProbes;
+	
+	// Reset the counters
+	successProbes = 0;
+	collisionProbes = 0;
+	idleProbes = 0;
+}
+
+int Simulation::probeNode(std::vector<Station>* stations, int node, int shuffle)
+{
+	int hits = 0;
+	for(int n = 0; n < stationsN && hits < 2; n++)
+	{
+		if(((*stations)[n].number >> shuffle) == node && (*stations)[n].active == true)
+			hits++;
+	}
+	
+	return hits;
+}
+
+// Walks down from the root, probing a few spread out nodes at each level. The first level where none of the sampled nodes collide has roughly one ready station per node,
+// which is the same level the oracle gets from round(log2(K)). Every probe here is a real probe on the channel, so it is counted like any other.
+int Simulation::estimateStartLevel(std::vector<Station>* stations, int levelCount)
+{
+	for(int level = 0; level < levelCount - 1; level++)
+	{
+		int shuffle = levelCount - 1 - level;
+		int nodesAtLevel = ((stationsN - 1) >> shuffle) + 1; // Only nodes with stations under them, when stationsN is not a power of 2 the rest would always be idle
+		int stride = nodesAtLevel / ESTIMATION_SAMPLES;
+		if(stride == 0)
+			stride = 1;
+		
+		int firstNode = estimationRandom() % nodesAtLevel;
+		bool collision = false;
+		sampledNodes.clear();
+		for(int sample = 0; sample < ESTIMATION_SAMPLES && sample < nodesAtLevel; sample++)
+		{
+			int node = (firstNode + sample * stride) % nodesAtLevel;
+			sampledNodes.push_back(node);
+			
+			int hits = probeNode(stations, node, shuffle);
+			if(hits == 2)
+			{
+				collision = true;
+				collisionProbes++;
+				logProbe(TRACE_COLLISION);
+			}
+			else if(hits == 1)
+			{
+				successProbes++;
+				logProbe(TRACE_SUCCESS);
+			}
+			else
+			{
+				idleProbes++;
+				logProbe(TRACE_IDLE);
+			}
+		}
+		
+		if(collision == false)
+			return level; // sampledNodes are left for the walk to skip, their outcomes are already counted
+	}
+	
+	sampledNodes.clear(); // The leaf level was never sampled
+	return levelCount - 1; // Leaf level, can never collide
 }
 
 void Simulation::basicProbeWalkthrough(std::vector<Station>* stations, int nodesToProbe, int shuffle, int nodeOffset)
@@ -127,15 +400,18 @@ void Simulation::basicProbeWalkthrough(std::vector<Station>* stations, int nodes
 		if(collision == true) // If this happens, we need to go into the causing node, which is the current one.
 		{
 			collisionProbes++;
+			logProbe(TRACE_COLLISION);
 			basicProbeWalkthrough(stations, 2, shuffle - 1, (node + nodeOffset) * 2); // Always probe for 2 nodes, since we are binary a collision means only 2 branches to go through from this level. (works fine in case of 1 leaf node)
 		}
 		else if(hitActive == true)
 		{
 			successProbes++;
+			logProbe(TRACE_SUCCESS);
 		}
 		else // No actives found, so wasted probe (idle).
 		{
 			idleProbes++;
+			logProbe(TRACE_IDLE);
 		}
 	}
 }
@@ -152,6 +428,10 @@ void Simulation::advancedProbeWalkthrough(std::vector<Station>* stations, int no
 		bool hitActive = false;
 		bool collision = false;
 		
+		// Only the starting call has no parent collision. Its nodes that the estimation phase already probed (none of which collided) would just be counted twice.
+		if(parentHadCollision == false && std::find(sampledNodes.begin(), sampledNodes.end(), node + nodeOffset) != sampledNodes.end())
+			continue;
+		
 		// When shuffle == 0 that means we are at the leaf level as we are checking each stations full exact number. If we are at this point there will never be a collision.
 		if(parentHadCollision == true && otherNodeWasIdle == true && shuffle != 0)
 		{
@@ -178,19 +458,26 @@ void Simulation::advancedProbeWalkthrough(std::vector<Station>* stations, int no
 		{
 			// Only increment collisionProbes if we actually probed for that collision. See above for the case where we avoid the probe, but know its a collison. 
 			if(parentHadCollision == false || otherNodeWasIdle == false)
+			{
 				collisionProbes++;
-			
+				logProbe(TRACE_COLLISION);
+			}
+			else
+				logProbe(TRACE_INFERRED_COLLISION);
+
 			advancedProbeWalkthrough(stations, 2, shuffle - 1, (node + nodeOffset) * 2, true); // See comment here in basicProbeWalkthrough
 		}
 		else if(hitActive == true)
 		{
 			successProbes++;
+			logProbe(TRACE_SUCCESS);
 			readyStationsLeft--;
 		}
 		else // No actives found, so wasted probe (idle).
 		{
 			otherNodeWasIdle = true;
 			idleProbes++;
+			logProbe(TRACE_IDLE);
 		}
 	}
 }
@@ -210,6 +497,64 @@ double Simulation::getIdleProbesPercent()
 	return cumulativeIdlePercentage / (double)scenariosX * 100;
 }
 
+double Simulation::getOracleSuccessProbesPercent()
+{
+	return cumulativeOracleSuccessPercentage / (double)scenariosX * 100;
+}
+
+double Simulation::getOracleCollisionProbesPercent()
+{
+	return cumulativeOracleCollisionPercentage / (double)scenariosX * 100;
+}
+
+double Simulation::getOracleIdleProbesPercent()
+{
+	return cumulativeOracleIdlePercentage / (double)scenariosX * 100;
+}
+
+double Simulation::getAverageEstimatedLevel()
+{
+	return cumulativeEstimatedLevel / (double)scenariosX;
+}
+
+int Simulation::getResultRecords(ResultRecord* records)
+{
+	int count = 0;
+	if(useBasicAlg == false && estimateK == true) // The oracle result goes right above the estimated result it was run alongside
+	{
+		records[count].stationsN = stationsN;
+		records[count].readyStationsK = readyStationsK;
+		records[count].scenariosX = scenariosX;
+		records[count].startLevel = oracleProbeLevel;
+		records[count].successPercent = getOracleSuccessProbesPercent();
+		records[count].collisionPercent = getOracleCollisionProbesPercent();
+		records[count].idlePercent = getOracleIdleProbesPercent();
+		records[count].algorithm = RESULT_ADVANCED;
+		count++;
+	}
+	
+	records[count].stationsN = stationsN;
+	records[count].readyStationsK = readyStationsK;
+	records[count].scenariosX = scenariosX;
+	records[count].startLevel = probeLevelActuallyUsed;
+	records[count].successPercent = getSuccessProbesPercent();
+	records[count].collisionPercent = getCollisionProbesPercent();
+	records[count].idlePercent = getIdleProbesPercent();
+	records[count].algorithm = RESULT_BASIC;
+	
+	if(useBasicAlg == false && estimateK == true)
+	{
+		records[count].startLevel = getAverageEstimatedLevel(); // Estimated per scenario, so this is the average
+		records[count].algorithm = RESULT_ESTIMATED;
+	}
+	else if(useBasicAlg == false)
+	{
+		records[count].algorithm = RESULT_ADVANCED;
+	}
+	
+	return count + 1;
+}
+
 
 
 
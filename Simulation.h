@@ -1,9 +1,12 @@
 #ifndef SIMULATION_H
 #define SIMULATION_H
 
+#include <random>
 #include <string>
 #include <vector>
 
+struct ResultRecord;
+
 struct Station
 {
 	bool active = false;
@@ -17,18 +20,31 @@ class Simulation
 		int readyStationsK = 1;
 		int probeLevelI = 0;
 		int probeLevelActuallyUsed = 0; // two probe levels for copying and display purposes. 
+		int oracleProbeLevel = 0; // Start level the advanced algorithm gets when it is told K, kept for display next to the estimated run.
 		int scenariosX = 100;
 		bool useBasicAlg = true;
+		bool estimateK = false; // Advanced only: K is not known, so it is estimated in-band by probing before the walk starts.
 		
 		Simulation();
-		Simulation(int n, int k, int i, int x, bool basic);
+		Simulation(int n, int k, int i, int x, bool basic, bool estimate);
+		
+		std::string traceFile; // When set, run() captures every scenario's active stations and probe outcomes to this file.
 		
 		std::string run(); // Returns a message from running.
+		bool replay(std::string path, std::string* returnMessage); // Re-runs this simulation's algorithm on the station sets in a trace and diffs the probe outcomes. False if nothing could be replayed, in which case nothing was changed. On success stationsN, readyStationsK and scenariosX are the trace's.
 		
 		double getSuccessProbesPercent();
 		double getCollisionProbesPercent();
 		double getIdleProbesPercent();
 		
+		// Results of the advanced algorithm given the true K, run on the same scenarios as the estimated run. Only filled when estimateK is set.
+		double getOracleSuccessProbesPercent();
+		double getOracleCollisionProbesPercent();
+		double getOracleIdleProbesPercent();
+		double getAverageEstimatedLevel();
+		
+		int getResultRecords(ResultRecord* records); // Fills in at most 2 records (the advanced result comes before the estimated one), returns how many
+		
 	private:
 		int successProbes = 0;
 		int collisionProbes = 0;
@@ -39,6 +55,24 @@ class Simulation
 		double cumulativeCollisionPercentage = 0;
 		double cumulativeIdlePercentage = 0;
 		
+		double cumulativeOracleSuccessPercentage = 0;
+		double cumulativeOracleCollisionPercentage = 0;
+		double cumulativeOracleIdlePercentage = 0;
+		double cumulativeEstimatedLevel = 0;
+		
+		std::vector<unsigned char>* probeLog = NULL; // Probe outcomes of the current scenario go here while capturing or replaying
+		std::vector<int> sampledNodes; // Nodes at the estimated start level that the estimation phase already probed, so the walk skips them
+		std::minstd_rand estimationRandom; // Only the estimation phase draws from this, so replaying a scenario's seed samples the same nodes
+		
+		int traceAlgorithm(); // The TRACE_ALG_ value for this simulation's algorithm, used both to capture and to check a replay against the trace
+		void resetResults(); // So the same simulation can be run again without its previous results mixing in
+		int prepareLevels(std::string* returnMessage); // Returns the number of levels in the tree, clamping K and I to fit it
+		void runScenario(std::vector<Station>* stations, int levelCount, unsigned int seed); // Probes one scenario whose ready stations are already active
+		void logProbe(unsigned char outcome);
+		void addScenarioPercentages(double* success, double* collision, double* idle); // Adds the current counters to the given cumulative percentages, then resets the counters
+		int probeNode(std::vector<Station>* stations, int node, int shuffle); // Returns how many active stations are under the node, capped at 2 (collision)
+		int estimateStartLevel(std::vector<Station>* stations, int levelCount); // The estimation probes are counted in the success/collision/idle counters
+		
 		// Comparing these two algorithms:
 		// If the active stations is known, and the start level is simply being guessed for basic, than the advanced will outpreform the basic alg.
 		// If the basic is given the same start level as advanced, the advanced algorithm performs better than the basic algorithm the less total% of active stations there are.
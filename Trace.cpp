@@ -0,0 +1,201 @@
+#include <algorithm>    // std::sort
+#include <string.h>     // memcpy, memcmp
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Trace.h"
+
+#define TRACE_MAGIC			"ATWT"
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	20
+#define TRACE_COUNT_OFFSET	16 // Where the scenario count sits in the header
+#define TRACE_MAX_STATIONS	1048576 // 2^20, the most stations a simulation can be set to
+
+const char* traceOutcomeName(unsigned char outcome)
+{
+	if(outcome == TRACE_IDLE)
+		return "idle";
+	else if(outcome == TRACE_SUCCESS)
+		return "success";
+	else if(outcome == TRACE_COLLISION)
+		return "collision";
+	else
+		return "inferred collision";
+}
+
+bool TraceWriter::open(std::string path, int stationsN, int probeLevelI, int algorithm)
+{
+	this->algorithm = algorithm;
+	
+	file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(file.is_open() == false)
+		return false;
+	
+	unsigned char header[TRACE_HEADER_SIZE] = {0};
+	memcpy(header, TRACE_MAGIC, 4);
+	header[4] = TRACE_VERSION;
+	header[5] = (unsigned char)algorithm;
+	memcpy(header + 8, &stationsN, 4);
+	memcpy(header + 12, &probeLevelI, 4);
+	memcpy(header + TRACE_COUNT_OFFSET, &scenarioCount, 4); // Still 0, filled in by close()
+	file.write((const char*)header, TRACE_HEADER_SIZE);
+	
+	return file.good();
+}
+
+void TraceWriter::writeScenario(unsigned int seed, std::vector<int>* activeIds, std::vector<unsigned char>* outcomes)
+{
+	buffer.clear();
+	if(algorithm == TRACE_ALG_ESTIMATED)
+		putVarint(seed);
+	
+	// Sorted IDs make every gap small, so most of them fit in a single byte
+	std::sort(activeIds->begin(), activeIds->end());
+	putVarint(activeIds->size());
+	int previous = 0;
+	for(unsigned int k = 0; k < activeIds->size(); k++)
+	{
+		putVarint((*activeIds)[k] - previous);
+		previous = (*activeIds)[k];
+	}
+	
+	putVarint(outcomes->size());
+	unsigned char packed = 0;
+	for(unsigned int p = 0; p < outcomes->size(); p++)
+	{
+		packed |= ((*outcomes)[p] & 3) << ((p % 4) * 2);
+		if(p % 4 == 3)
+		{
+			buffer.push_back(packed);
+			packed = 0;
+		}
+	}
+	if(outcomes->size() % 4 != 0)
+		buffer.push_back(packed);
+	
+	file.write((const char*)buffer.data(), buffer.size());
+	scenarioCount++;
+}
+
+void TraceWriter::close()
+{
+	file.seekp(TRACE_COUNT_OFFSET);
+	file.write((const char*)&scenarioCount, 4);
+	file.close();
+}
+
+void TraceWriter::putVarint(unsigned int value)
+{
+	// 7 bits at a time, low bits first, the high bit set on every byte but the last
+	while(value >= 0x80)
+	{
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+TraceReader::TraceReader()
+{
+	
+}
+
+TraceReader::~TraceReader()
+{
+	if(data != NULL)
+		munmap((void*)data, size);
+}
+
+bool TraceReader::open(std::string path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size < TRACE_HEADER_SIZE)
+	{
+		::close(fd);
+		return false;
+	}
+	
+	void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping stays valid without the descriptor
+	if(mapped == MAP_FAILED)
+		return false;
+	
+	data = (const unsigned char*)mapped;
+	size = info.st_size;
+	madvise(mapped, size, MADV_SEQUENTIAL); // Replay reads it front to back exactly once
+	
+	if(memcmp(data, TRACE_MAGIC, 4) != 0 || data[4] != TRACE_VERSION)
+		return false;
+	
+	algorithm = data[5];
+	memcpy(&stationsN, data + 8, 4);
+	memcpy(&probeLevelI, data + 12, 4);
+	memcpy(&scenarioCount, data + TRACE_COUNT_OFFSET, 4);
+	cursor = TRACE_HEADER_SIZE;
+	
+	return stationsN > 0 && stationsN <= TRACE_MAX_STATIONS;
+}
+
+bool TraceReader::nextScenario(TraceScenario* scenario)
+{
+	scenario->seed = 0;
+	if(algorithm == TRACE_ALG_ESTIMATED && getVarint(&scenario->seed) == false)
+		return false;
+	
+	unsigned int count;
+	if(getVarint(&count) == false || count == 0 || count > (unsigned int)stationsN)
+		return false;
+	
+	scenario->activeIds.clear();
+	unsigned int id = 0;
+	for(unsigned int k = 0; k < count; k++)
+	{
+		unsigned int gap;
+		if(getVarint(&gap) == false)
+			return false;
+		
+		if(k > 0 && gap == 0) // The same station twice
+			return false;
+		
+		if(gap >= (unsigned int)stationsN - id) // Past the last station
+			return false;
+		
+		id += gap;
+		scenario->activeIds.push_back(id);
+	}
+	
+	if(getVarint(&count) == false)
+		return false;
+	
+	// Worked out without adding to count, so a huge count can not wrap around and pass the check against the bytes left
+	size_t packedBytes = count / 4 + (count % 4 != 0);
+	if(packedBytes > size - cursor)
+		return false;
+	
+	scenario->outcomes.resize(count);
+	for(unsigned int p = 0; p < count; p++)
+		scenario->outcomes[p] = (data[cursor + p / 4] >> ((p % 4) * 2)) & 3;
+	cursor += packedBytes;
+	
+	return true;
+}
+
+bool TraceReader::getVarint(unsigned int* value)
+{
+	*value = 0;
+	for(int shift = 0; shift < 35 && cursor < size; shift += 7)
+	{
+		unsigned char byte = data[cursor++];
+		*value |= (unsigned int)(byte & 0x7F) << shift;
+		if((byte & 0x80) == 0)
+			return true;
+	}
+	
+	return false;
+}
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Probe outcomes, 2 bits each in the trace
+#define TRACE_IDLE					0
+#define TRACE_SUCCESS				1
+#define TRACE_COLLISION				2
+#define TRACE_INFERRED_COLLISION	3 // Advanced algorithm only, a collision it knew about without probing
+
+const char* traceOutcomeName(unsigned char outcome);
+
+#define TRACE_ALG_BASIC		0
+#define TRACE_ALG_ADVANCED	1
+#define TRACE_ALG_ESTIMATED	2
+
+// Trace layout, in the byte order of the machine that captured it:
+// Header: "ATWT", version, algorithm, 2 unused bytes, then stationsN, probeLevelI and the scenario count as 32 bit ints.
+// Each scenario: varint seed (only in TRACE_ALG_ESTIMATED traces, nothing else uses it), varint K, K varint active IDs (the first as is, the rest as the gap from the one before), varint probe count, then the outcomes packed 4 to a byte.
+
+struct TraceScenario
+{
+	unsigned int seed = 0; // 0 unless the trace is TRACE_ALG_ESTIMATED
+	std::vector<int> activeIds;
+	std::vector<unsigned char> outcomes; // Unpacked, one outcome per entry
+};
+
+class TraceWriter
+{
+	public:
+		bool open(std::string path, int stationsN, int probeLevelI, int algorithm);
+		void writeScenario(unsigned int seed, std::vector<int>* activeIds, std::vector<unsigned char>* outcomes); // Sorts activeIds
+		void close(); // Fills in the scenario count in the header
+	
+	private:
+		std::ofstream file;
+		std::vector<unsigned char> buffer; // Reused for every scenario
+		int scenarioCount = 0;
+		int algorithm = 0;
+		
+		void putVarint(unsigned int value);
+};
+
+class TraceReader
+{
+	public:
+		int stationsN = 0;
+		int probeLevelI = 0;
+		int algorithm = 0;
+		int scenarioCount = 0;
+		
+		TraceReader();
+		~TraceReader();
+		TraceReader(const TraceReader&) = delete;
+		TraceReader& operator=(const TraceReader&) = delete;
+		
+		bool open(std::string path); // Memory maps the whole trace, false if it is missing or not a trace
+		bool nextScenario(TraceScenario* scenario); // false once the trace runs out, including when it is cut short
+	
+	private:
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		size_t cursor = 0;
+		
+		bool getVarint(unsigned int* value);
+};
+
+#endif